@@ -0,0 +1,54 @@
+import time
+
+import numpy as np
+
+import napf
+
+
+def per_call_us(f, *args, n=100000):
+    """
+    Returns average time of a call in micro seconds.
+    """
+    t0 = time.perf_counter()
+    for _ in range(n):
+        f(*args)
+    return (time.perf_counter() - t0) / n * 1e6
+
+
+if __name__ == "__main__":
+    tree_data = np.random.random((100000, 3))
+    kdt = napf.KDT(tree_data)
+
+    point = np.random.random(3)
+    x, y, z = point.tolist()
+    queries = point.reshape(1, 3)
+    dist, ids = kdt.knn_buffers(1, 4)
+    r_ids, r_dist = kdt.radius_buffers()
+
+    calls = [
+        ("query(queries)", kdt.query, (queries,)),
+        ("query_point(point)", kdt.query_point, (point,)),
+        ("query_point(x, y, z)", kdt.query_point, (x, y, z)),
+        ("knn_search(queries, 4)", kdt.knn_search, (queries, 4)),
+        (
+            "knn_search_into(queries, 4, ...)",
+            kdt.knn_search_into,
+            (queries, 4, dist, ids),
+        ),
+        (
+            "radius_search(queries, .05)",
+            kdt.radius_search,
+            (queries, 0.05, True),
+        ),
+        (
+            "radius_search_into(point, .05, ...)",
+            kdt.radius_search_into,
+            (point, 0.05, True, r_ids, r_dist),
+        ),
+    ]
+
+    print("/****************************************************************/")
+    print("per call time, including search [us]:")
+    for name, f, args in calls:
+        print(f"  {name:<38}{per_call_us(f, *args):.2f}")
+    print("/****************************************************************/")
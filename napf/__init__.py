@@ -1,9 +1,10 @@
 from napf import _napf
 from napf import _napf as core
-from napf import base
+from napf import base, tuning
 from napf._version import version as __version__
 from napf.base import (
     KDT,
+    KDTForest,
     core_class_str_and_data,
     np2napf_dtypes,
     validate_metric_input,
@@ -13,9 +14,11 @@ __all__ = [
     "_napf",
     "core",
     "base",
+    "tuning",
     "np2napf_dtypes",
     "validate_metric_input",
     "core_class_str_and_data",
     "KDT",
+    "KDTForest",
     "__version__",
 ]
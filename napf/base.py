@@ -1,3 +1,6 @@
+import threading
+from concurrent.futures import Future
+
 import numpy as np
 
 from napf import _napf as core  # noqa: F401
@@ -126,6 +129,10 @@ class KDT:
     leaf_size: int
     nthread: int
       Default thread count for all multi-thread-
+    auto_tune: bool or dict
+      Default is False. If True, leaf_size, nthread and batch sizes below
+      which searches run serially are chosen by `napf.tuning.tune()`.
+      dict is passed to `tune()` as keyword arguments.
 
     Returns
     --------
@@ -136,14 +143,17 @@ class KDT:
         "_core_tree",
         "_nthread",
         "_dtype",
+        "_tuning",
     )
 
-    def __init__(self, tree_data, metric=2, leaf_size=10, nthread=1):
+    def __init__(
+        self, tree_data, metric=2, leaf_size=10, nthread=1, auto_tune=False
+    ):
         """
         Init
         """
-        self.newtree(tree_data, metric, leaf_size, nthread)
         self.nthread = nthread
+        self.newtree(tree_data, metric, leaf_size, nthread, auto_tune)
 
     @property
     def nthread(self):
@@ -222,7 +232,74 @@ class KDT:
         """
         return self._dtype
 
-    def newtree(self, tree_data, metric=2, leaf_size=10, nthread=1):
+    @property
+    def tuning(self):
+        """
+        Returns choices of auto-tune. None, if tree isn't auto-tuned.
+
+        Parameters
+        -----------
+        None
+
+        Returns
+        --------
+        tuning: dict
+          See `napf.tuning.tune()`.
+        """
+        return self._tuning
+
+    def _auto_tune(self, tree_data, metric, auto_tune):
+        """
+        internal use fn to run auto-tune and set default nthread.
+
+        Parameters
+        -----------
+        tree_data: (n, d) np.ndarray
+        metric: int or str
+        auto_tune: bool or dict
+
+        Returns
+        --------
+        leaf_size_and_build_nthread: tuple
+        """
+        # base is imported by tuning
+        from napf import tuning
+
+        options = auto_tune if isinstance(auto_tune, dict) else {}
+        self._tuning = tuning.tune(tree_data, metric, **options)
+        self.nthread = self._tuning["nthread"]
+
+        return self._tuning["leaf_size"], self._tuning["build_nthread"]
+
+    def _resolve_nthread(self, method, n_queries, nthread):
+        """
+        internal use fn to get nthread for a search call.
+        Explicit nthread is always used. Otherwise, auto-tuned trees run
+        batches smaller than method's threshold serially.
+
+        Parameters
+        -----------
+        method: str
+        n_queries: int
+        nthread: int or None
+
+        Returns
+        --------
+        nthread: int
+        """
+        if nthread is not None:
+            return nthread
+
+        if self._tuning is not None:
+            threshold = self._tuning["thresholds"].get(method, 0)
+            if n_queries < threshold:
+                return 1
+
+        return self.nthread
+
+    def newtree(
+        self, tree_data, metric=2, leaf_size=10, nthread=1, auto_tune=False
+    ):
         """
         Given 2D array-like tree_data, it:
           1. makes sure data is a contiguous array
@@ -235,11 +312,19 @@ class KDT:
         -----------
         tree_data: (n, d) np.ndarray
           {double, float, int, long}
-
+        metric: int or str
+        leaf_size: int
+        nthread: int
+        auto_tune: bool or dict
+          If set, leaf_size and nthread are ignored and tuned values are
+          used instead.
         """
         core_cls, tdata = core_class_str_and_data(
             np.ascontiguousarray(tree_data), metric
         )  # checks and raises error
+        self._tuning = None
+        if auto_tune:
+            leaf_size, nthread = self._auto_tune(tdata, metric, auto_tune)
         # we can call newtree() function of the core class,
         # if _core_tree already exists.
         # However, creating a new kdt should not add significant overhead.
@@ -257,6 +342,7 @@ class KDT:
         kneighbors: int
         nthread: int
           Default is None and will use self.nthread.
+          Auto-tuned trees run small batches serially.
 
         Returns
         --------
@@ -264,8 +350,7 @@ class KDT:
           ((m, kneighbors) np.ndarray - double dists,)
            (m, kneighbors) np.ndarray - uint ids)
         """
-        if nthread is None:
-            nthread = self.nthread
+        nthread = self._resolve_nthread("knn_search", len(queries), nthread)
 
         return self.core_tree.knn_search(
             enforce_contiguous(queries, self.dtype), kneighbors, nthread
@@ -282,6 +367,7 @@ class KDT:
           Data type will be casted to the same type as `tree_data`.
         nthread: int
           Default is None and will use self.nthread.
+          Auto-tuned trees run small batches serially.
 
         Returns
         --------
@@ -289,13 +375,119 @@ class KDT:
           ((m, 1) np.ndarray - double dists,)
            (m, 1) np.ndarray - uint ids)
         """
-        if nthread is None:
-            nthread = self.nthread
+        nthread = self._resolve_nthread("query", len(queries), nthread)
 
         return self.core_tree.query(
             enforce_contiguous(queries, self.dtype), nthread
         )
 
+    def query_point(self, *point):
+        """
+        Low-latency nearest neighbor search for a single point.
+        Skips input checks and output array allocations of `query`.
+        For 1, 2, and 3D trees, coordinates can be given as separate scalars,
+        which also skips array creation.
+
+        Parameters
+        -----------
+        point: scalars or (d,) array-like
+          Either `x`, `x, y`, `x, y, z` or a single point.
+
+        Returns
+        --------
+        distance_and_id: tuple
+          (float - dist, int - id)
+        """
+        return self._core_tree.query_point(*point)
+
+    def knn_buffers(self, n_queries, kneighbors):
+        """
+        Creates output arrays for `knn_search_into`.
+
+        Parameters
+        -----------
+        n_queries: int
+        kneighbors: int
+
+        Returns
+        --------
+        distances_and_ids: tuple
+          ((n_queries, kneighbors) np.ndarray - float32 or float64 dists,
+           (n_queries, kneighbors) np.ndarray - uint32 ids)
+        """
+        dist_t = np.float32 if self.dtype == np.float32 else np.float64
+        return (
+            np.empty((n_queries, kneighbors), dtype=dist_t),
+            np.empty((n_queries, kneighbors), dtype=np.uint32),
+        )
+
+    def knn_search_into(self, queries, kneighbors, dist, ids, nthread=1):
+        """
+        Same as `knn_search`, but writes into given, reusable arrays.
+        Meant for a small number of queries. See `knn_buffers`.
+        If kneighbors exceeds number of tree data, rest of the entries will
+        have dummy filled in - they will be the maximum value of each data
+        type.
+
+        Parameters
+        -----------
+        queries: (m, d) or (d,) np.ndarray
+          Data type will be casted to the same type as `tree_data`.
+        kneighbors: int
+        dist: np.ndarray
+          C-contiguous with at least m * kneighbors entries.
+        ids: np.ndarray
+          C-contiguous uint32 array with at least m * kneighbors entries.
+        nthread: int
+          Default is 1.
+
+        Returns
+        --------
+        None
+        """
+        self._core_tree.knn_search_into(
+            queries, kneighbors, dist, ids, nthread
+        )
+
+    def radius_buffers(self):
+        """
+        Creates output vectors for `radius_search_into`.
+
+        Parameters
+        -----------
+        None
+
+        Returns
+        --------
+        ids_and_distances: tuple
+          (UIntVector, FloatVector or DoubleVector)
+        """
+        if self.dtype == np.float32:
+            return core.UIntVector(), core.FloatVector()
+
+        return core.UIntVector(), core.DoubleVector()
+
+    def radius_search_into(self, point, radius, return_sorted, ids, dist):
+        """
+        Searches for neighbors of a single point in given radius and writes
+        into given, reusable vectors. See `radius_buffers`.
+
+        Parameters
+        -----------
+        point: (d,) np.ndarray
+        radius: float
+        return_sorted: bool
+        ids: UIntVector
+        dist: FloatVector or DoubleVector
+
+        Returns
+        --------
+        n_matches: int
+        """
+        return self._core_tree.radius_search_into(
+            point, radius, return_sorted, ids, dist
+        )
+
     def radius_search(self, queries, radius, return_sorted, nthread=None):
         """
         Searches for neighbors in given radius.
@@ -307,7 +499,8 @@ class KDT:
         radius: float
         return_sorted: bool
         nthread: int
-          Default is None and will use self.nthread
+          Default is None and will use self.nthread.
+          Auto-tuned trees run small batches serially.
 
         Returns
         --------
@@ -315,8 +508,7 @@ class KDT:
           ((m, 1) np.ndarray - uint ids,
            (m, 1) np.ndarray - double dists)
         """
-        if nthread is None:
-            nthread = self.nthread
+        nthread = self._resolve_nthread("radius_search", len(queries), nthread)
 
         return self.core_tree.radius_search(
             enforce_contiguous(queries, self.dtype),
@@ -345,8 +537,7 @@ class KDT:
           ((m, 1) np.ndarray - uint ids,
            (m, 1) np.ndarray - double dists)
         """
-        if nthread is None:
-            nthread = self.nthread
+        nthread = self._resolve_nthread("rknn_search", len(queries), nthread)
 
         return self.core_tree.rknn_search(
             enforce_contiguous(queries, self.dtype),
@@ -366,15 +557,17 @@ class KDT:
         radius: float
         return_sorted: bool
         nthread: int
-          Default is None and will use self.nthread
+          Default is None and will use self.nthread.
+          Auto-tuned trees run small batches serially.
 
         Returns
         -------
         ids: list
           list of np.array
         """
-        if nthread is None:
-            nthread = self.nthread
+        nthread = self._resolve_nthread(
+            "query_ball_point", len(queries), nthread
+        )
 
         return self.core_tree.query_ball_point(
             enforce_contiguous(queries, self.dtype),
@@ -394,7 +587,8 @@ class KDT:
         radii: (m,) np.ndarray
         return_sorted: bool
         nthread: int
-          Default is None and will use self.nthread
+          Default is None and will use self.nthread.
+          Auto-tuned trees run small batches serially.
 
         Returns
         --------
@@ -410,8 +604,7 @@ class KDT:
                 "They should be the same."
             )
 
-        if nthread is None:
-            nthread = self.nthread
+        nthread = self._resolve_nthread("radii_search", len(queries), nthread)
 
         return self.core_tree.radii_search(
             enforce_contiguous(queries, self.dtype),
@@ -478,3 +671,240 @@ class KDT:
             )
         else:
             return np.array(), unique_ids, inverse_ids, intersection
+
+
+class KDTForest(KDT):
+    """
+    Forest of independently built kd-trees (shards). Same search interface as
+    `KDT`, but data can be appended as new shards without rebuilding
+    existing ones. Searches fan out across shards and share their pruning
+    bounds, so returned distances are the same as `KDT`'s. Ids can differ
+    for equidistant points.
+
+    Point ids are 32-bit unsigned ints. Total number of points and
+    number of points * dim of a single shard must not exceed 2**32 - 1.
+    `append()` and `compact()` raise OverflowError otherwise.
+
+    Like `KDT`, non-spatial shards of tree_data reference it without a copy,
+    so tree_data must not be modified afterwards. The same applies to data
+    appended with `copy=False`.
+
+    Parameters
+    -----------
+    tree_data: (n, dim) np.ndarray
+      {double, float, int, long}
+    metric: int or str
+      Default is 2 and distance will be a squared euklidian distance.
+      Valid options are {1, l1, L1, 2, l2, L2}.
+    leaf_size: int
+    nthread: int
+      Default thread count for build and all multi-thread-queries.
+    auto_tune: bool or dict
+      Default is False. See `KDT`. Calibration runs on a single `KDT`,
+      forest reuses its leaf_size, nthread and thresholds. Tuned
+      build_nthread sets number of shard build threads and, unless n_shards
+      is given, number of shards.
+    n_shards: int
+      Keyword only. Default is None and will use one shard per thread.
+    spatial: bool
+      Keyword only. Default is False and shards will be contiguous chunks of
+      tree_data. If True, tree_data is partitioned along its widest extents
+      and each shard keeps a copy of its partition. This allows queries to
+      skip whole shards.
+
+    Returns
+    --------
+    core_obj: KDTForest{data_t}L{metric}
+    """
+
+    __slots__ = ()
+
+    def __init__(
+        self,
+        tree_data,
+        metric=2,
+        leaf_size=10,
+        nthread=1,
+        auto_tune=False,
+        *,
+        n_shards=None,
+        spatial=False,
+    ):
+        """
+        Init
+        """
+        self.nthread = nthread
+        self.newtree(
+            tree_data,
+            metric,
+            leaf_size,
+            nthread,
+            auto_tune,
+            n_shards=n_shards,
+            spatial=spatial,
+        )
+
+    @property
+    def tree_data(self):
+        """
+        Forest does not keep a single tree data array. Returns None.
+        """
+        return None
+
+    @property
+    def size(self):
+        """
+        Returns number of points in all the shards.
+        """
+        return self.core_tree.size
+
+    @property
+    def n_shards(self):
+        """
+        Returns number of shards.
+        """
+        return self.core_tree.n_shards
+
+    @property
+    def shard_sizes(self):
+        """
+        Returns number of points in each shard.
+        """
+        return self.core_tree.shard_sizes
+
+    def newtree(
+        self,
+        tree_data,
+        metric=2,
+        leaf_size=10,
+        nthread=1,
+        auto_tune=False,
+        *,
+        n_shards=None,
+        spatial=False,
+    ):
+        """
+        Given 2D array-like tree_data, builds a new forest.
+        Shards are built in parallel. Positional arguments are the same as
+        `KDT.newtree`.
+
+        Parameters
+        -----------
+        tree_data: (n, d) np.ndarray
+          {double, float, int, long}
+        metric: int or str
+        leaf_size: int
+        nthread: int
+        auto_tune: bool or dict
+          Reuses single tree calibration, see `KDTForest`.
+        n_shards: int
+          Keyword only.
+        spatial: bool
+          Keyword only.
+        """
+        core_cls, tdata = core_class_str_and_data(
+            np.ascontiguousarray(tree_data), metric
+        )  # checks and raises error
+        self._tuning = None
+        if auto_tune:
+            leaf_size, nthread = self._auto_tune(tdata, metric, auto_tune)
+        core_cls = core_cls.replace("KDT", "KDTForest", 1)
+        if n_shards is None:
+            n_shards = 0
+
+        self._core_tree = eval(
+            f"core.{core_cls}(tdata, n_shards, spatial, leaf_size, nthread)"
+        )
+        self._dtype = tdata.dtype
+
+    def append(
+        self, data, n_shards=1, spatial=False, nthread=None, copy=True
+    ):
+        """
+        Adds data as new shard(s). Existing shards are not rebuilt.
+        Appended points get ids following the current ones.
+        Raises OverflowError, if ids would exceed 32-bit unsigned int.
+
+        Parameters
+        -----------
+        data: (m, d) np.ndarray
+          Data type will be casted to the same type as `tree_data`.
+        n_shards: int
+        spatial: bool
+        nthread: int
+          Default is None and will use self.nthread.
+        copy: bool
+          Default is True and shards keep their own copy of data. If False,
+          shards reference data, which then must not be modified afterwards,
+          e.g. by refilling a reused buffer. Spatial shards always copy.
+
+        Returns
+        --------
+        None
+        """
+        data = np.ascontiguousarray(data, dtype=self.dtype)
+        if data.ndim != 2 or data.shape[1] != self.core_tree.dim:
+            raise ValueError(
+                f"Appending data should have shape (m, {self.core_tree.dim})."
+                f" Given data's shape is {data.shape}."
+            )
+
+        if nthread is None:
+            nthread = self.nthread
+
+        self.core_tree.append(data, n_shards, spatial, copy, nthread)
+
+    def compact(self, min_shard_size, nthread=None, background=False):
+        """
+        Merges all the shards with less than `min_shard_size` points into a
+        single shard. Searches stay valid during compaction.
+        Raises OverflowError, if merged shard's points * dim would exceed
+        32-bit unsigned int.
+
+        Parameters
+        -----------
+        min_shard_size: int
+        nthread: int
+          Default is None and will use self.nthread.
+        background: bool
+          Default is False. If True, compaction runs in a separate thread.
+          Call `result()` of the returned future before the interpreter
+          exits - it returns number of shards or re-raises compaction's
+          error.
+
+        Returns
+        --------
+        n_shards_or_future: int or concurrent.futures.Future
+          Number of shards after compaction. If background is True, future
+          of it.
+        """
+        if nthread is None:
+            nthread = self.nthread
+
+        if not background:
+            return self.core_tree.compact(min_shard_size, nthread)
+
+        future = Future()
+
+        def run():
+            if not future.set_running_or_notify_cancel():
+                return
+            try:
+                future.set_result(
+                    self.core_tree.compact(min_shard_size, nthread)
+                )
+            except BaseException as e:
+                future.set_exception(e)
+
+        # not a daemon, so that interpreter doesn't exit mid compaction
+        threading.Thread(target=run, name="napf-compact").start()
+
+        return future
+
+    def unique_data_and_inverse(self, *args, **kwargs):
+        """
+        Not supported for forests.
+        """
+        raise NotImplementedError(
+            "unique_data_and_inverse is not supported for KDTForest."
+        )
@@ -0,0 +1,304 @@
+import copy
+import math
+import os
+import time
+
+import numpy as np
+
+from napf import _napf as core
+from napf.base import core_class_str_and_data
+
+# tuning results per dataset shape
+_cache = {}
+
+
+def _best_time(f, repeat):
+    """
+    internal use fn to get best of `repeat` runs in seconds.
+
+    Parameters
+    -----------
+    f: callable
+    repeat: int
+
+    Returns
+    --------
+    seconds: float
+    """
+    best = math.inf
+    for _ in range(repeat):
+        t0 = time.perf_counter()
+        f()
+        best = min(best, time.perf_counter() - t0)
+
+    return best
+
+
+def _available_cpus():
+    """
+    internal use fn. Returns number of cpus this process may run on, which
+    respects cpu affinity of containers and pinned jobs.
+
+    Returns
+    --------
+    n_cpus: int
+    """
+    if hasattr(os, "sched_getaffinity"):
+        return max(len(os.sched_getaffinity(0)), 1)
+
+    return os.cpu_count() or 1
+
+
+def _thread_candidates(max_nthread):
+    """
+    internal use fn. Returns 1, 2, 4, ... up to and including max_nthread.
+
+    Parameters
+    -----------
+    max_nthread: int
+
+    Returns
+    --------
+    candidates: list
+    """
+    candidates = [1]
+    while candidates[-1] * 2 < max_nthread:
+        candidates.append(candidates[-1] * 2)
+    if max_nthread > 1:
+        candidates.append(max_nthread)
+
+    return candidates
+
+
+def cache_key(tree_data, metric, max_nthread=None, **options):
+    """
+    Returns key used to cache tuning results. Datasets with same dtype,
+    dim, metric and similar size (power of two) share the key, as long as
+    they are calibrated with the same options.
+
+    Parameters
+    -----------
+    tree_data: (n, dim) np.ndarray
+    metric: int or str
+    max_nthread: int
+    options: kwargs
+      Calibration options of `tune()`, e.g. leaf_sizes or kneighbors.
+
+    Returns
+    --------
+    key: tuple
+    """
+    core_cls, arr = core_class_str_and_data(np.asarray(tree_data), metric)
+    if max_nthread is None:
+        max_nthread = _available_cpus()
+
+    return (
+        core_cls,
+        arr.shape[1],
+        int(round(math.log2(max(len(arr), 1)))),
+        max_nthread,
+        tuple(
+            (name, tuple(value) if np.iterable(value) else value)
+            for name, value in sorted(options.items())
+        ),
+    )
+
+
+def clear_cache():
+    """
+    Removes all the cached tuning results.
+    """
+    _cache.clear()
+
+
+def tune(
+    tree_data,
+    metric=2,
+    queries=None,
+    leaf_sizes=(4, 8, 16, 32, 64),
+    max_nthread=None,
+    sample_size=20000,
+    build_sample_size=200000,
+    kneighbors=8,
+    repeat=3,
+    refresh=False,
+    verbose=False,
+):
+    """
+    Runs a short calibration on a sample of tree_data and queries and chooses
+    leaf size, build thread count, query thread count and per search method
+    batch sizes, below which queries run serially.
+    Results are cached per dataset shape and options, see `cache_key`.
+    Calibrations with user given queries are not cached.
+
+    Parameters
+    -----------
+    tree_data: (n, dim) np.ndarray
+      {double, float, int, long}
+    metric: int or str
+    queries: (m, dim) np.ndarray
+      Default is None and will use perturbed samples of tree_data.
+    leaf_sizes: iterable
+      Candidate leaf sizes.
+    max_nthread: int
+      Default is None and will use number of cpus this process may use.
+    sample_size: int
+      Number of tree data and queries used for leaf size and queries.
+    build_sample_size: int
+      Number of tree data used to choose build thread count.
+    kneighbors: int
+      Used for knn and rknn calibration. Radius based searches use a radius
+      that contains about kneighbors points.
+    repeat: int
+      Each timing is best of repeat runs.
+    refresh: bool
+      Default is False. If True, ignores cached results.
+    verbose: bool
+      Default is False. If True, prints chosen values.
+
+    Returns
+    --------
+    tuning: dict
+      {"leaf_size": int, "build_nthread": int, "nthread": int,
+       "thresholds": {method_name: int}, "key": tuple}
+    """
+    if max_nthread is None:
+        max_nthread = _available_cpus()
+
+    core_cls, tdata = core_class_str_and_data(
+        np.ascontiguousarray(tree_data), metric
+    )
+
+    key = cache_key(
+        tdata,
+        metric,
+        max_nthread,
+        leaf_sizes=leaf_sizes,
+        sample_size=sample_size,
+        build_sample_size=build_sample_size,
+        kneighbors=kneighbors,
+        repeat=repeat,
+    )
+    # results depend on queries, which we don't hash
+    use_cache = queries is None
+    if use_cache and not refresh and key in _cache:
+        if verbose:
+            print(f"napf.tune - using cached result for {key}.")
+            report(_cache[key])
+        return copy.deepcopy(_cache[key])
+
+    core_cls = getattr(core, core_cls)
+    rng = np.random.default_rng(0)
+
+    def sample(arr, size):
+        if len(arr) <= size:
+            return arr
+        return arr[np.sort(rng.choice(len(arr), size, replace=False))]
+
+    data_sample = sample(tdata, sample_size)
+    # small trees can't return more neighbors than they have
+    kneighbors = max(min(kneighbors, len(data_sample)), 1)
+    if queries is None:
+        # perturb, so that queries don't hit tree data exactly
+        queries = sample(tdata, sample_size)
+        # extents of sample, as a full pass over tdata can take long
+        extent = data_sample.max(axis=0) - data_sample.min(axis=0)
+        spacing = extent / len(data_sample) ** (1 / tdata.shape[1])
+        noise = (rng.random(queries.shape) - 0.5) * spacing
+        queries = queries + noise.astype(queries.dtype)
+    qdata = np.ascontiguousarray(
+        sample(np.asarray(queries), sample_size), tdata.dtype
+    )
+
+    # leaf size - fastest serial knn. among similar ones, take larger leaf,
+    # as it builds faster and uses less memory
+    leaf_times = {}
+    for leaf_size in leaf_sizes:
+        kdt = core_cls(data_sample, leaf_size, 1)
+        leaf_times[leaf_size] = _best_time(
+            lambda: kdt.knn_search(qdata, kneighbors, 1), repeat
+        )
+    best = min(leaf_times.values())
+    leaf_size = max(ls for ls, t in leaf_times.items() if t <= best * 1.05)
+
+    # build thread count
+    build_sample = sample(tdata, build_sample_size)
+    build_times = {
+        n: _best_time(lambda: core_cls(build_sample, leaf_size, n), repeat)
+        for n in _thread_candidates(max_nthread)
+    }
+    build_nthread = min(build_times, key=build_times.get)
+
+    # query thread count
+    kdt = core_cls(data_sample, leaf_size, build_nthread)
+    query_times = {
+        n: _best_time(lambda: kdt.knn_search(qdata, kneighbors, n), repeat)
+        for n in _thread_candidates(max_nthread)
+    }
+    nthread = min(query_times, key=query_times.get)
+
+    # thresholds - parallel pays off once saved work exceeds thread overhead
+    #   m * c > m * c / nthread + overhead
+    dist, _ = kdt.knn_search(qdata, kneighbors, nthread)
+    radius = float(np.median(dist[:, -1]))
+    radii = np.full(len(qdata), radius)
+    calls = {
+        "knn_search": lambda q, n: kdt.knn_search(q, kneighbors, n),
+        "query": lambda q, n: kdt.query(q, n),
+        "radius_search": lambda q, n: kdt.radius_search(q, radius, False, n),
+        "rknn_search": lambda q, n: kdt.rknn_search(
+            q, radius, kneighbors, n
+        ),
+        "query_ball_point": lambda q, n: kdt.query_ball_point(
+            q, radius, False, n
+        ),
+        "radii_search": lambda q, n: kdt.radii_search(
+            q, radii[: len(q)], False, n
+        ),
+    }
+    thresholds = {}
+    few = qdata[:nthread]
+    for method, call in calls.items():
+        if nthread == 1:
+            thresholds[method] = 0
+            continue
+        per_query = _best_time(lambda: call(qdata, 1), repeat) / len(qdata)
+        overhead = _best_time(lambda: call(few, nthread), repeat) - per_query
+        saved = per_query * (1 - 1 / nthread)
+        thresholds[method] = max(int(math.ceil(max(overhead, 0) / saved)), 1)
+
+    tuning = {
+        "leaf_size": leaf_size,
+        "build_nthread": build_nthread,
+        "nthread": nthread,
+        "thresholds": thresholds,
+        "key": key,
+    }
+    if use_cache:
+        _cache[key] = copy.deepcopy(tuning)
+
+    if verbose:
+        report(tuning)
+
+    return tuning
+
+
+def report(tuning):
+    """
+    Prints tuning result.
+
+    Parameters
+    -----------
+    tuning: dict
+
+    Returns
+    --------
+    None
+    """
+    print("napf.tune")
+    print(f"  leaf_size:     {tuning['leaf_size']}")
+    print(f"  build_nthread: {tuning['build_nthread']}")
+    print(f"  nthread:       {tuning['nthread']}")
+    print("  serial below batch size of:")
+    for method, threshold in tuning["thresholds"].items():
+        print(f"    {method:<18}{threshold}")
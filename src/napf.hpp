@@ -59,4 +59,62 @@ template<typename DataT>
 using DistT = typename std::
     conditional<std::is_same<DataT, float>::value, float, double>::type;
 
+/*
+ * Result set adapter to share one nanoflann result set between multiple
+ * trees (shards of a forest). Local indices of a shard are translated to
+ * global indices either by an offset or by an explicit id map.
+ * Sorting is left to the caller, so that it only happens once after all
+ * shards are searched.
+ *
+ * TParameters
+ * ------------
+ * ResultSetT: nanoflann result set, e.g. KNNResultSet
+ * IndexT: index type
+ */
+template<typename ResultSetT, typename IndexT>
+class ShardResultSet {
+public:
+  using DistanceType = typename ResultSetT::DistanceType;
+
+  ShardResultSet(ResultSetT& result, const IndexT offset, const IndexT* ids)
+      : result_(result),
+        offset_(offset),
+        ids_(ids) {}
+
+  inline size_t size() const { return result_.size(); }
+
+  inline bool full() const { return result_.full(); }
+
+  inline bool addPoint(DistanceType dist, IndexT index) {
+    return result_.addPoint(dist, (ids_) ? ids_[index] : offset_ + index);
+  }
+
+  inline DistanceType worstDist() const { return result_.worstDist(); }
+
+  inline void sort() {}
+
+private:
+  ResultSetT& result_;
+  const IndexT offset_;
+  const IndexT* ids_;
+};
+
+/// minimum distance between a query and the bounding box of a tree,
+/// measured with the tree's own metric. Used to skip whole trees.
+template<typename TreeT, typename DataT>
+typename TreeT::DistanceType root_bbox_distance(const TreeT& tree,
+                                                const DataT* query) {
+  using DistanceType = typename TreeT::DistanceType;
+  DistanceType dist{};
+  for (int i{}; i < static_cast<int>(tree.dim_); ++i) {
+    const auto& interval = tree.root_bbox_[i];
+    if (query[i] < interval.low) {
+      dist += tree.distance_.accum_dist(query[i], interval.low, i);
+    } else if (query[i] > interval.high) {
+      dist += tree.distance_.accum_dist(query[i], interval.high, i);
+    }
+  }
+  return dist;
+}
+
 } // namespace napf
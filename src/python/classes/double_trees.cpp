@@ -1,10 +1,13 @@
 #include "../pykdt.hpp"
+#include "../pykdt_forest.hpp"
 
 namespace napf {
 
 void init_double_trees(py::module_& m) {
   add_kdt_pyclass<double, 1>(m, "KDTdL1");
   add_kdt_pyclass<double, 2>(m, "KDTdL2");
+  add_kdt_forest_pyclass<double, 1>(m, "KDTForestdL1");
+  add_kdt_forest_pyclass<double, 2>(m, "KDTForestdL2");
 }
 
 } // namespace napf
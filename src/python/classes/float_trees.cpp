@@ -1,10 +1,13 @@
 #include "../pykdt.hpp"
+#include "../pykdt_forest.hpp"
 
 namespace napf {
 
 void init_float_trees(py::module_& m) {
   add_kdt_pyclass<float, 1>(m, "KDTfL1");
   add_kdt_pyclass<float, 2>(m, "KDTfL2");
+  add_kdt_forest_pyclass<float, 1>(m, "KDTForestfL1");
+  add_kdt_forest_pyclass<float, 2>(m, "KDTForestfL2");
 }
 
 } // namespace napf
@@ -1,10 +1,13 @@
 #include "../pykdt.hpp"
+#include "../pykdt_forest.hpp"
 
 namespace napf {
 
 void init_int_trees(py::module_& m) {
   add_kdt_pyclass<int32_t, 1>(m, "KDTiL1");
   add_kdt_pyclass<int32_t, 2>(m, "KDTiL2");
+  add_kdt_forest_pyclass<int32_t, 1>(m, "KDTForestiL1");
+  add_kdt_forest_pyclass<int32_t, 2>(m, "KDTForestiL2");
 }
 
 } // namespace napf
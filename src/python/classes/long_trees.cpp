@@ -1,10 +1,13 @@
 #include "../pykdt.hpp"
+#include "../pykdt_forest.hpp"
 
 namespace napf {
 
 void init_long_trees(py::module_& m) {
   add_kdt_pyclass<int64_t, 1>(m, "KDTlL1");
   add_kdt_pyclass<int64_t, 2>(m, "KDTlL2");
+  add_kdt_forest_pyclass<int64_t, 1>(m, "KDTForestlL1");
+  add_kdt_forest_pyclass<int64_t, 2>(m, "KDTForestlL2");
 }
 
 } // namespace napf
@@ -32,6 +32,19 @@ using IndexType = typename UIntVector::value_type;
 using IndexVector = UIntVector;
 using IndexVectorVector = UIntVectorVector;
 
+// input arrays are casted and made contiguous if needed.
+// outputs aren't, as writing into a converted copy would be lost.
+template<typename Type>
+using ContiguousArray =
+    py::array_t<Type, py::array::c_style | py::array::forcecast>;
+template<typename Type>
+using OutputArray = py::array_t<Type, py::array::c_style>;
+
+// distance type of DataT - see PyKDT
+template<typename DataT>
+using DistType = typename std::
+    conditional<std::is_same<DataT, float>::value, float, double>::type;
+
 // helper function to get dummy values
 template<typename Type>
 Type max_and_negative_if_signed() {
@@ -42,14 +55,182 @@ Type max_and_negative_if_signed() {
   return max_val;
 }
 
+/*
+ * Single query fast path, shared by PyKDT and PyKDTForest.
+ *
+ * Derived classes provide dim_ and
+ *   template<typename ResultSetT>
+ *   void search_one(const DataT* query, ResultSetT& result) const
+ * which fills a nanoflann KNNResultSet or RadiusResultSet with neighbors of
+ * a single query. Everything else - input checks, dummy values and copies
+ * into reusable outputs - lives here.
+ */
+template<typename Derived, typename DataT, typename DistT>
+class PySingleQuery {
+public:
+  /* returns (distance, index) of the nearest neighbor as python scalars.
+   * scalar overloads are for 1, 2, and 3D */
+  py::tuple query_point_1d(const DataT x) const {
+    const DataT point[1]{x};
+    return nearest(point, 1);
+  }
+
+  py::tuple query_point_2d(const DataT x, const DataT y) const {
+    const DataT point[2]{x, y};
+    return nearest(point, 2);
+  }
+
+  py::tuple query_point_3d(const DataT x, const DataT y, const DataT z) const {
+    const DataT point[3]{x, y, z};
+    return nearest(point, 3);
+  }
+
+  py::tuple query_point(const ContiguousArray<DataT> point) const {
+    return nearest(point.data(), static_cast<int>(point.size()));
+  }
+
+  /* knn search that writes into given, reusable output arrays.
+   * meant for small query batches, where allocations dominate */
+  void knn_search_into(const ContiguousArray<DataT> qpts,
+                       const int kneighbors,
+                       OutputArray<DistT> dist,
+                       OutputArray<IndexType> indices,
+                       const int nthread) const {
+    const int dim = derived().dim_;
+    const int qlen = static_cast<int>(qpts.size() / dim);
+    if (qpts.size() != static_cast<py::ssize_t>(qlen) * dim
+        || dist.size() < static_cast<py::ssize_t>(qlen) * kneighbors
+        || indices.size() < static_cast<py::ssize_t>(qlen) * kneighbors) {
+      std::cout << "CRITICAL WARNING - " << "queries (" << qpts.size()
+                << ") should be a multiple of dim (" << dim
+                << ") and outputs (" << dist.size() << ", " << indices.size()
+                << ") should hold at least queries * kneighbors entries! "
+                << "skipping search." << std::endl;
+      return;
+    }
+    if (qlen == 0) {
+      return;
+    }
+
+    const DataT* q_ptr = qpts.data();
+    DistT* d_ptr = dist.mutable_data();
+    IndexType* i_ptr = indices.mutable_data();
+
+    // outputs are reused, so entries beyond data size get dummy values
+    const DistT dummy_dist = max_and_negative_if_signed<DistT>();
+    const IndexType dummy_index = max_and_negative_if_signed<IndexType>();
+
+    auto searchknn = [&](int begin, int end, int) {
+      for (int i{begin}; i < end; i++) {
+        const int k{i * kneighbors};
+        nanoflann::KNNResultSet<DistT, IndexType> result(kneighbors);
+        result.init(&i_ptr[k], &d_ptr[k]);
+        derived().search_one(&q_ptr[i * dim], result);
+        for (int j{k + static_cast<int>(result.size())}; j < k + kneighbors;
+             ++j) {
+          i_ptr[j] = dummy_index;
+          d_ptr[j] = dummy_dist;
+        }
+      }
+    };
+
+    nthread_execution(searchknn, qlen, nthread);
+  }
+
+  /* single query radius search that writes into given, reusable vectors.
+   * returns number of matches */
+  IndexType radius_search_into(const ContiguousArray<DataT> point,
+                               const DistT radius,
+                               const bool return_sorted,
+                               std::vector<IndexType>& indices,
+                               std::vector<DistT>& dist) {
+    if (point.size() != derived().dim_) {
+      std::cout << "CRITICAL WARNING - " << "query size (" << point.size()
+                << ") and dim (" << derived().dim_ << ") differ! "
+                << "skipping search." << std::endl;
+      return 0;
+    }
+
+    // clears matches
+    nanoflann::RadiusResultSet<DistT, IndexType> result(radius, matches_);
+    derived().search_one(point.data(), result);
+    if (return_sorted) {
+      result.sort();
+    }
+
+    const size_t nmatches = matches_.size();
+    indices.resize(nmatches);
+    dist.resize(nmatches);
+    for (size_t i{}; i < nmatches; ++i) {
+      indices[i] = matches_[i].first;
+      dist[i] = matches_[i].second;
+    }
+
+    return static_cast<IndexType>(nmatches);
+  }
+
+protected:
+  // reused by single query radius search
+  std::vector<nanoflann::ResultItem<IndexType, DistT>> matches_;
+
+  const Derived& derived() const { return static_cast<const Derived&>(*this); }
+
+  /* nearest neighbor of a single point */
+  py::tuple nearest(const DataT* point, const int point_dim) const {
+    if (point_dim != derived().dim_) {
+      std::cout << "CRITICAL WARNING - " << "query size (" << point_dim
+                << ") and dim (" << derived().dim_ << ") differ! "
+                << "returning empty tuple." << std::endl;
+      return py::tuple{};
+    }
+
+    IndexType index{};
+    DistT dist{};
+    nanoflann::KNNResultSet<DistT, IndexType> result(1);
+    result.init(&index, &dist);
+    derived().search_one(point, result);
+
+    return py::make_tuple(dist, index);
+  }
+};
+
+/* binds single query fast path of a PySingleQuery derived class */
+template<typename PyClass>
+void add_single_query_defs(py::class_<PyClass>& klasse) {
+  klasse.def("query_point", &PyClass::query_point_1d, py::arg("x"))
+      .def("query_point", &PyClass::query_point_2d, py::arg("x"), py::arg("y"))
+      .def("query_point",
+           &PyClass::query_point_3d,
+           py::arg("x"),
+           py::arg("y"),
+           py::arg("z"))
+      .def("query_point", &PyClass::query_point, py::arg("point"))
+      .def("knn_search_into",
+           &PyClass::knn_search_into,
+           py::arg("queries"),
+           py::arg("kneighbors"),
+           py::arg("dist").noconvert(),
+           py::arg("indices").noconvert(),
+           py::arg("nthread") = 1)
+      .def("radius_search_into",
+           &PyClass::radius_search_into,
+           py::arg("point"),
+           py::arg("radius"),
+           py::arg("return_sorted"),
+           py::arg("indices"),
+           py::arg("dist"));
+}
+
 template<typename DataT, unsigned int metric>
-class PyKDT {
+class PyKDT
+    : public PySingleQuery<PyKDT<DataT, metric>, DataT, DistType<DataT>> {
+  friend class PySingleQuery<PyKDT, DataT, DistType<DataT>>;
+
 public:
   // let's fix some datatype.
   //   distance is always double, unless DataT is float
   //   index is always unsigned int
-  using DistT = typename std::
-      conditional<std::is_same<DataT, float>::value, float, double>::type;
+  using DistT = DistType<DataT>;
   using DistVector =
       typename std::conditional<std::is_same<DistT, float>::value,
                                 FloatVector,
@@ -459,6 +640,15 @@ public:
 
     return py::make_tuple<py::return_value_policy::move>(out_indices, out_dist);
   }
+
+protected:
+  /* single query search for PySingleQuery */
+  template<typename ResultSetT>
+  void search_one(const DataT* query, ResultSetT& result) const {
+    nanoflann::SearchParameters params;
+    params.sorted = false;
+    tree_->findNeighbors(result, query, params);
+  }
 };
 
 template<typename T, unsigned int metric>
@@ -490,7 +680,11 @@ void add_kdt_pyclass(py::module_& m, const char* class_name) {
            &KDT::query,
            py::arg("queries"),
            py::arg("nthread"),
-           py::return_value_policy::move)
+           py::return_value_policy::move);
+
+  add_single_query_defs(klasse);
+
+  klasse
       .def("radius_search",
            &KDT::radius_search,
            py::arg("queries"),
@@ -0,0 +1,870 @@
+#pragma once
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <pybind11/numpy.h>
+#include <pybind11/pybind11.h>
+
+#include "../napf.hpp"
+#include "pykdt.hpp"
+#include "threadhelper.hpp"
+
+namespace napf {
+
+namespace py = pybind11;
+
+/*
+ * Forest of independently built kd-trees (shards).
+ *
+ * Each shard is a plain ArrayTree, so shards can be built in parallel and
+ * new data can be appended as new shards without touching existing ones.
+ * Queries fan out over all shards and share a single result set, so the
+ * current worst distance of the result prunes the remaining shards.
+ *
+ * Shards either reference contiguous chunks of input data (global id is
+ * offset + local id) or own a spatially partitioned copy of it (global id is
+ * looked up in ids).
+ *
+ * Global ids and shard cloud lengths (points * dim) are IndexType, so
+ * append and compact throw before either would overflow.
+ */
+template<typename DataT, unsigned int metric>
+class PyKDTForest : public PySingleQuery<PyKDTForest<DataT, metric>,
+                                         DataT,
+                                         DistType<DataT>> {
+  friend class PySingleQuery<PyKDTForest, DataT, DistType<DataT>>;
+
+public:
+  using KDT = PyKDT<DataT, metric>;
+  using DistT = typename KDT::DistT;
+  using DistVector = typename KDT::DistVector;
+  using DistVectorVector = typename KDT::DistVectorVector;
+  using Tree = typename KDT::Tree;
+  using Cloud = typename KDT::Cloud;
+
+  /* a single tree of the forest */
+  struct Shard {
+    // keeps buffer alive. either whole input array or owned copy.
+    py::array_t<DataT> data_;
+    const DataT* data_ptr_ = nullptr;
+    IndexType datalen_ = 0;
+    IndexType offset_ = 0;
+    IndexVector ids_;
+    std::unique_ptr<Cloud> cloud_;
+    std::unique_ptr<Tree> tree_;
+
+    const IndexType* ids_ptr() const {
+      return (ids_.empty()) ? nullptr : ids_.data();
+    }
+
+    IndexType global_id(const IndexType local_id) const {
+      return (ids_.empty()) ? offset_ + local_id : ids_[local_id];
+    }
+
+    /* doesn't touch any python objects */
+    void build(const int dim, const size_t leaf_size, const int nthread) {
+      nanoflann::KDTreeSingleIndexAdaptorParams params(
+          leaf_size,
+          nanoflann::KDTreeSingleIndexAdaptorFlags::None,
+          static_cast<unsigned int>(nthread));
+      cloud_ = std::unique_ptr<Cloud>(
+          new Cloud(data_ptr_, datalen_ * static_cast<IndexType>(dim), dim));
+      tree_ = std::unique_ptr<Tree>(new Tree(dim, *cloud_, params));
+    }
+  };
+
+  using ShardPtr = std::unique_ptr<Shard>;
+
+  int dim_{};
+  const unsigned int metric_ = metric;
+  size_t leaf_size_{10};
+  int nthread_{1};
+
+  IndexType datalen_ = 0;
+  std::vector<ShardPtr> shards_;
+
+  // serializes modifications (newforest, append, compact)
+  std::mutex modify_mutex_;
+
+  PyKDTForest() = default;
+
+  PyKDTForest(py::array_t<DataT> tree_data,
+              const int n_shards,
+              const bool spatial,
+              const size_t leaf_size,
+              const int nthread) {
+    newforest(tree_data, n_shards, spatial, leaf_size, nthread);
+  }
+
+  /* builds a new forest. n_shards <= 0 uses number of threads. */
+  void newforest(py::array_t<DataT> tree_data,
+                 const int n_shards = 0,
+                 const bool spatial = false,
+                 const size_t leaf_size = 10,
+                 const int nthread = 1) {
+    {
+      py::gil_scoped_release release;
+      std::lock_guard<std::mutex> lock(modify_mutex_);
+      py::gil_scoped_acquire acquire;
+      dim_ = tree_data.shape(1);
+      leaf_size_ = leaf_size;
+      nthread_ = nthread;
+      datalen_ = 0;
+      shards_.clear();
+    }
+    // same as KDT, initial tree data is referenced, not copied
+    append(tree_data, n_shards, spatial, false, nthread);
+  }
+
+  /* adds data as new shard(s). existing shards stay as they are.
+   * without copy, chunked shards reference data, so it must not be modified
+   * afterwards. spatial shards always own a copy. */
+  void append(py::array_t<DataT> data,
+              const int n_shards,
+              const bool spatial,
+              const bool copy,
+              const int nthread) {
+    if (data.ndim() != 2 || data.shape(1) != dim_) {
+      std::cout << "CRITICAL WARNING - " << "appending data's dim ("
+                << ((data.ndim() == 2) ? data.shape(1) : -1)
+                << ") does not match forest's dim (" << dim_ << ")! "
+                << "data won't be added." << std::endl;
+      return;
+    }
+    if (data.shape(0) == 0) {
+      return;
+    }
+
+    // build without gil, so that other python threads can query meanwhile.
+    py::gil_scoped_release release;
+    std::lock_guard<std::mutex> lock(modify_mutex_);
+
+    std::vector<ShardPtr> new_shards;
+    IndexType new_datalen{};
+    const DataT* d_ptr{};
+    int n_new_shards{};
+    {
+      py::gil_scoped_acquire acquire;
+      n_new_shards = (n_shards > 0) ? n_shards : resolve_nthread(nthread);
+      const size_t len = static_cast<size_t>(data.shape(0));
+      // spatial shards are checked once their sizes are known
+      const size_t chunk = (len + n_new_shards - 1) / n_new_shards;
+      check_index_limit(static_cast<size_t>(datalen_) + len,
+                        (spatial) ? 0 : chunk);
+      new_datalen = static_cast<IndexType>(len);
+      // data argument keeps buffer alive until we return
+      d_ptr = static_cast<const DataT*>(data.request().ptr);
+      if (!spatial) {
+        new_shards = chunked_shards(data, n_new_shards, copy);
+      }
+    }
+
+    if (spatial) {
+      new_shards = spatial_shards(d_ptr, new_datalen, n_new_shards, nthread);
+    } else if (copy) {
+      copy_chunks(d_ptr, new_shards, nthread);
+    }
+
+    build_shards(new_shards, nthread);
+
+    {
+      py::gil_scoped_acquire acquire;
+      for (auto& shard : new_shards) {
+        shards_.emplace_back(std::move(shard));
+      }
+      new_shards.clear();
+      datalen_ += new_datalen;
+    }
+  }
+
+  /* merges all the shards smaller than min_shard_size into a single shard.
+   * returns number of shards after compaction. */
+  int compact(const IndexType min_shard_size, const int nthread) {
+    py::gil_scoped_release release;
+    std::lock_guard<std::mutex> lock(modify_mutex_);
+
+    std::vector<const Shard*> small_shards;
+    std::vector<ShardPtr> merged(1);
+    {
+      py::gil_scoped_acquire acquire;
+      for (const auto& shard : shards_) {
+        if (shard->datalen_ < min_shard_size) {
+          small_shards.push_back(shard.get());
+        }
+      }
+      if (small_shards.size() < 2) {
+        return static_cast<int>(shards_.size());
+      }
+
+      size_t total{};
+      for (const auto* shard : small_shards) {
+        total += shard->datalen_;
+      }
+      check_index_limit(datalen_, total);
+
+      merged[0] = ShardPtr(new Shard);
+      merged[0]->data_ = py::array_t<DataT>(
+          {static_cast<py::ssize_t>(total), static_cast<py::ssize_t>(dim_)});
+      merged[0]->data_ptr_ =
+          static_cast<DataT*>(merged[0]->data_.request().ptr);
+      merged[0]->datalen_ = static_cast<IndexType>(total);
+    }
+
+    Shard& shard = *merged[0];
+
+    // offset is enough if merged shards were contiguous chunks
+    bool contiguous{true};
+    IndexType next_offset = small_shards[0]->offset_;
+    for (const auto* small : small_shards) {
+      contiguous = contiguous && small->ids_.empty()
+                   && (small->offset_ == next_offset);
+      next_offset = small->offset_ + small->datalen_;
+    }
+    if (contiguous) {
+      shard.offset_ = small_shards[0]->offset_;
+    } else {
+      shard.ids_.resize(shard.datalen_);
+    }
+
+    // copy data (and ids) - each small shard is copied by a thread
+    std::vector<IndexType> begins(small_shards.size(), 0);
+    for (size_t i{1}; i < small_shards.size(); ++i) {
+      begins[i] = begins[i - 1] + small_shards[i - 1]->datalen_;
+    }
+    auto copy = [&](int begin, int end, int) {
+      for (int i{begin}; i < end; ++i) {
+        const Shard& small = *small_shards[i];
+        std::copy(small.data_ptr_,
+                  small.data_ptr_ + static_cast<size_t>(small.datalen_) * dim_,
+                  const_cast<DataT*>(shard.data_ptr_)
+                      + static_cast<size_t>(begins[i]) * dim_);
+        if (!contiguous) {
+          for (IndexType j{}; j < small.datalen_; ++j) {
+            shard.ids_[begins[i] + j] = small.global_id(j);
+          }
+        }
+      }
+    };
+    nthread_execution(copy,
+                      static_cast<int>(small_shards.size()),
+                      resolve_nthread(nthread));
+
+    build_shards(merged, nthread);
+
+    py::gil_scoped_acquire acquire;
+    shards_.erase(std::remove_if(shards_.begin(),
+                                 shards_.end(),
+                                 [&](const ShardPtr& s) {
+                                   return std::find(small_shards.begin(),
+                                                    small_shards.end(),
+                                                    s.get())
+                                          != small_shards.end();
+                                 }),
+                  shards_.end());
+    shards_.emplace_back(std::move(merged[0]));
+    merged.clear();
+
+    return static_cast<int>(shards_.size());
+  }
+
+  int n_shards() const { return static_cast<int>(shards_.size()); }
+
+  py::array_t<IndexType> shard_sizes() const {
+    py::array_t<IndexType> sizes(shards_.size());
+    IndexType* s_ptr = static_cast<IndexType*>(sizes.request().ptr);
+    for (size_t i{}; i < shards_.size(); ++i) {
+      s_ptr[i] = shards_[i]->datalen_;
+    }
+    return sizes;
+  }
+
+  /* given query points, returns indices and distances */
+  py::tuple knn_search(const py::array_t<DataT> qpts,
+                       const int kneighbors,
+                       const int nthread) {
+
+    // in
+    const py::buffer_info q_buf = qpts.request();
+    const DataT* q_buf_ptr = static_cast<DataT*>(q_buf.ptr);
+    const int qlen = q_buf.shape[0];
+
+    // out
+    py::array_t<IndexType> indices({qlen, kneighbors});
+    py::array_t<DistT> dist({qlen, kneighbors});
+    IndexType* i_ptr = static_cast<IndexType*>(indices.request().ptr);
+    DistT* d_ptr = static_cast<DistT*>(dist.request().ptr);
+
+    if (kneighbors > static_cast<int>(datalen_)) {
+      std::cout << "WARNING - " << "kneighbors (" << kneighbors
+                << ") is bigger than number of tree data (" << datalen_ << "! "
+                << "Returning arrays `[:, " << datalen_ - kneighbors
+                << ":]` entries will be filled with random indices."
+                << std::endl;
+    }
+
+    auto searchknn = [&](int begin, int end, int) {
+      ShardOrder order;
+      for (int i{begin}; i < end; i++) {
+        const int k{i * kneighbors};
+        nanoflann::KNNResultSet<DistT, IndexType> result(kneighbors);
+        result.init(&i_ptr[k], &d_ptr[k]);
+        search_nearest(&q_buf_ptr[i * dim_], result, order);
+      }
+    };
+
+    nthread_execution(searchknn, qlen, nthread);
+
+    return py::make_tuple(dist, indices);
+  }
+
+  /* scipy KDTree style query */
+  py::tuple query(const py::array_t<DataT> qpts, const int nthread) {
+    return knn_search(qpts, 1, nthread);
+  }
+
+  /* radius search */
+  py::tuple radius_search(const py::array_t<DataT> qpts,
+                          const DistT radius,
+                          const bool return_sorted,
+                          const int nthread) {
+    // in
+    const py::buffer_info q_buf = qpts.request();
+    const DataT* q_buf_ptr = static_cast<DataT*>(q_buf.ptr);
+    const int qlen = q_buf.shape[0];
+
+    // out
+    IndexVectorVector out_indices(qlen);
+    DistVectorVector out_dist(qlen);
+
+    auto searchradius = [&](int begin, int end, int) {
+      std::vector<nanoflann::ResultItem<IndexType, DistT>> matches;
+      for (int i{begin}; i < end; i++) {
+        search_radius(&q_buf_ptr[i * dim_], radius, return_sorted, matches);
+
+        auto& this_indices = out_indices[i];
+        auto& this_dist = out_dist[i];
+        this_indices.reserve(matches.size());
+        this_dist.reserve(matches.size());
+
+        for (auto& match : matches) {
+          this_indices.emplace_back(match.first);
+          this_dist.emplace_back(match.second);
+        }
+      }
+    };
+
+    nthread_execution(searchradius, qlen, nthread);
+
+    return py::make_tuple<py::return_value_policy::move>(out_indices, out_dist);
+  }
+
+  /* radius knn search */
+  py::tuple rknn_search(const py::array_t<DataT> qpts,
+                        const DistT radius,
+                        const int n_nearest,
+                        const int nthread) {
+
+    // in
+    const py::buffer_info q_buf = qpts.request();
+    const DataT* q_buf_ptr = static_cast<DataT*>(q_buf.ptr);
+    const int qlen = q_buf.shape[0];
+
+    // out
+    py::array_t<IndexType> indices({qlen, n_nearest});
+    py::array_t<DistT> distances({qlen, n_nearest});
+    IndexType* i_ptr = static_cast<IndexType*>(indices.request().ptr);
+    DistT* d_ptr = static_cast<DistT*>(distances.request().ptr);
+
+    auto searchradiusknn = [&](int begin, int end, int) {
+      ShardOrder order;
+      const DistT dummy_dist = max_and_negative_if_signed<DistT>();
+      const IndexType dummy_index = max_and_negative_if_signed<IndexType>();
+      for (int i{begin}; i < end; i++) {
+        IndexType* t_i_ptr = &i_ptr[i * n_nearest];
+        DistT* t_d_ptr = &d_ptr[i * n_nearest];
+
+        nanoflann::RKNNResultSet<DistT, IndexType> result(n_nearest, radius);
+        result.init(t_i_ptr, t_d_ptr);
+        search_nearest(&q_buf_ptr[i * dim_], result, order);
+
+        // in case nmatches < n_nearest, we fill the rest with dummy values
+        for (int j{static_cast<int>(result.size())}; j < n_nearest; ++j) {
+          t_i_ptr[j] = dummy_index;
+          t_d_ptr[j] = dummy_dist;
+        }
+      }
+    };
+
+    nthread_execution(searchradiusknn, qlen, nthread);
+
+    return py::make_tuple<py::return_value_policy::move>(indices, distances);
+  }
+
+  /// @brief scipy KDTree style query_ball_point
+  /// @param return_sorted here, sort is based on ids, not distance
+  IndexVectorVector query_ball_point(const py::array_t<DataT> qpts,
+                                     const DistT radius,
+                                     const bool return_sorted,
+                                     const int nthread) {
+    // in
+    const py::buffer_info q_buf = qpts.request();
+    const DataT* q_buf_ptr = static_cast<DataT*>(q_buf.ptr);
+    const int qlen = q_buf.shape[0];
+
+    // out
+    IndexVectorVector out_indices(qlen);
+
+    auto searchradius = [&](int begin, int end, int) {
+      std::vector<nanoflann::ResultItem<IndexType, DistT>> matches;
+      for (int i{begin}; i < end; i++) {
+        // we don't need distance based sorting
+        search_radius(&q_buf_ptr[i * dim_], radius, false, matches);
+
+        auto& this_indices = out_indices[i];
+        this_indices.reserve(matches.size());
+        for (auto& match : matches) {
+          this_indices.emplace_back(match.first);
+        }
+
+        if (return_sorted) {
+          std::sort(this_indices.begin(), this_indices.end());
+        }
+      }
+    };
+
+    nthread_execution(searchradius, qlen, nthread);
+
+    return out_indices;
+  }
+
+  /* radii search. in other words, each query can have different radius */
+  py::tuple radii_search(const py::array_t<DataT> qpts,
+                         const py::array_t<DistT> radii,
+                         const bool return_sorted,
+                         const int nthread) {
+    // in
+    const py::buffer_info q_buf = qpts.request();
+    const DataT* q_buf_ptr = static_cast<DataT*>(q_buf.ptr);
+    const int qlen = q_buf.shape[0];
+
+    const py::buffer_info r_buf = radii.request();
+    const DistT* r_buf_ptr = static_cast<DistT*>(r_buf.ptr);
+    const int rlen = r_buf.shape[0];
+
+    if (qlen != rlen) {
+      std::cout << "CRITICAL WARNING - " << "query length (" << qlen
+                << ") and radii length (" << rlen << ") differ! "
+                << "returning empty tuple." << std::endl;
+
+      return py::tuple{};
+    }
+
+    // out
+    IndexVectorVector out_indices(qlen);
+    DistVectorVector out_dist(qlen);
+
+    auto searchradius = [&](int begin, int end, int) {
+      std::vector<nanoflann::ResultItem<IndexType, DistT>> matches;
+      for (int i{begin}; i < end; i++) {
+        search_radius(&q_buf_ptr[i * dim_],
+                      r_buf_ptr[i],
+                      return_sorted,
+                      matches);
+
+        auto& this_indices = out_indices[i];
+        auto& this_dist = out_dist[i];
+        this_indices.reserve(matches.size());
+        this_dist.reserve(matches.size());
+
+        for (auto& match : matches) {
+          this_indices.emplace_back(match.first);
+          this_dist.emplace_back(match.second);
+        }
+      }
+    };
+
+    nthread_execution(searchradius, qlen, nthread);
+
+    return py::make_tuple<py::return_value_policy::move>(out_indices, out_dist);
+  }
+
+protected:
+  // (bbox distance, shard id) - reused per thread
+  using ShardOrder = std::vector<std::pair<DistT, int>>;
+
+  /* single query search for PySingleQuery */
+  template<typename ResultSetT>
+  void search_one(const DataT* query, ResultSetT& result) const {
+    // reused, so that single queries don't allocate
+    static thread_local ShardOrder order;
+    search_nearest(query, result, order);
+  }
+
+  /* searches shards in order of their bbox distance, so that close shards
+   * can tighten worst distance of the result before far ones are visited.
+   * works for KNNResultSet, RKNNResultSet and RadiusResultSet */
+  template<typename ResultSetT>
+  void search_nearest(const DataT* query,
+                      ResultSetT& result,
+                      ShardOrder& order) const {
+    order.clear();
+    for (int s{}; s < static_cast<int>(shards_.size()); ++s) {
+      order.emplace_back(root_bbox_distance(*shards_[s]->tree_, query), s);
+    }
+    std::sort(order.begin(), order.end());
+
+    nanoflann::SearchParameters params;
+    params.sorted = false;
+    for (const auto& o : order) {
+      // shared pruning bound - rest of the shards are farther away
+      if (o.first > result.worstDist()) {
+        break;
+      }
+      const Shard& shard = *shards_[o.second];
+      ShardResultSet<ResultSetT, IndexType> shard_result(result,
+                                                         shard.offset_,
+                                                         shard.ids_ptr());
+      shard.tree_->findNeighbors(shard_result, query, params);
+    }
+  }
+
+  /* radius search over all shards. matches are cleared first */
+  void search_radius(
+      const DataT* query,
+      const DistT radius,
+      const bool return_sorted,
+      std::vector<nanoflann::ResultItem<IndexType, DistT>>& matches) const {
+    using ResultSetT = nanoflann::RadiusResultSet<DistT, IndexType>;
+
+    ResultSetT result(radius, matches);
+    nanoflann::SearchParameters params;
+    params.sorted = false;
+    for (const auto& shard : shards_) {
+      if (!(root_bbox_distance(*shard->tree_, query) < radius)) {
+        continue;
+      }
+      ShardResultSet<ResultSetT, IndexType> shard_result(result,
+                                                         shard->offset_,
+                                                         shard->ids_ptr());
+      shard->tree_->findNeighbors(shard_result, query, params);
+    }
+
+    if (return_sorted) {
+      result.sort();
+    }
+  }
+
+  /* throws if number of points in forest or shard_len * dim of a shard
+   * exceed IndexType. Call with gil, before any new shard is created. */
+  void check_index_limit(const size_t total, const size_t shard_len) const {
+    const size_t limit = std::numeric_limits<IndexType>::max();
+    if (total > limit || shard_len * static_cast<size_t>(dim_) > limit) {
+      throw std::overflow_error(
+          "KDTForest - number of points (" + std::to_string(total)
+          + ") or shard size * dim (" + std::to_string(shard_len) + " * "
+          + std::to_string(dim_) + ") exceeds index limit ("
+          + std::to_string(limit) + ").");
+    }
+  }
+
+  /* builds given shards in parallel. python objects aren't touched here,
+   * so this runs without holding the gil */
+  void build_shards(std::vector<ShardPtr>& shards, const int nthread) const {
+    if (shards.empty()) {
+      return;
+    }
+    const int n_shards = static_cast<int>(shards.size());
+    const int n_threads = resolve_nthread(nthread);
+    // leftover threads go to each shard's own concurrent build
+    const int n_build_threads = std::max(n_threads / n_shards, 1);
+
+    auto build = [&](int begin, int end, int) {
+      for (int i{begin}; i < end; ++i) {
+        shards[i]->build(dim_, leaf_size_, n_build_threads);
+      }
+    };
+
+    nthread_execution(build, n_shards, n_threads);
+  }
+
+  /* shards of contiguous chunks of data. needs gil. shards either reference
+   * data or, with copy, own uninitialized buffers to be filled by
+   * copy_chunks. */
+  std::vector<ShardPtr> chunked_shards(py::array_t<DataT> data,
+                                       const int n_shards,
+                                       const bool copy) const {
+    const py::buffer_info d_buf = data.request();
+    const DataT* d_ptr = static_cast<DataT*>(d_buf.ptr);
+    const IndexType len = static_cast<IndexType>(d_buf.shape[0]);
+    const IndexType chunk = (len + n_shards - 1) / n_shards;
+
+    std::vector<ShardPtr> shards;
+    for (IndexType begin{}; begin < len; begin += chunk) {
+      ShardPtr shard(new Shard);
+      shard->datalen_ = std::min(chunk, len - begin);
+      shard->offset_ = datalen_ + begin;
+      if (copy) {
+        shard->data_ = py::array_t<DataT>(
+            {static_cast<py::ssize_t>(shard->datalen_),
+             static_cast<py::ssize_t>(dim_)});
+        shard->data_ptr_ = static_cast<DataT*>(shard->data_.request().ptr);
+      } else {
+        shard->data_ = data;
+        shard->data_ptr_ = d_ptr + static_cast<size_t>(begin) * dim_;
+      }
+      shards.emplace_back(std::move(shard));
+    }
+    return shards;
+  }
+
+  /* fills buffers of copying chunked shards. d_ptr is appended data. runs
+   * without gil. */
+  void copy_chunks(const DataT* d_ptr,
+                   std::vector<ShardPtr>& shards,
+                   const int nthread) const {
+    auto copy = [&](int begin, int end, int) {
+      for (int i{begin}; i < end; ++i) {
+        Shard& shard = *shards[i];
+        const DataT* chunk =
+            d_ptr + static_cast<size_t>(shard.offset_ - datalen_) * dim_;
+        std::copy(chunk,
+                  chunk + static_cast<size_t>(shard.datalen_) * dim_,
+                  const_cast<DataT*>(shard.data_ptr_));
+      }
+    };
+    nthread_execution(copy,
+                      static_cast<int>(shards.size()),
+                      resolve_nthread(nthread));
+  }
+
+  /* recursively bisects ids along the widest extent, until there are
+   * n_parts groups of (almost) equal size. */
+  void spatial_partition(const DataT* points,
+                         IndexType* begin,
+                         IndexType* end,
+                         const int first_part,
+                         const int n_parts,
+                         const int nthread,
+                         std::vector<std::pair<IndexType*, IndexType*>>& parts)
+      const {
+    if (n_parts == 1) {
+      parts[first_part] = std::make_pair(begin, end);
+      return;
+    }
+
+    // find widest dim
+    int split_dim{};
+    DistT widest{-1};
+    for (int d{}; d < dim_ && begin != end; ++d) {
+      DataT low = points[static_cast<size_t>(*begin) * dim_ + d];
+      DataT high = low;
+      for (IndexType* it{begin}; it != end; ++it) {
+        const DataT& value = points[static_cast<size_t>(*it) * dim_ + d];
+        low = std::min(low, value);
+        high = std::max(high, value);
+      }
+      const DistT extent = static_cast<DistT>(high) - static_cast<DistT>(low);
+      if (extent > widest) {
+        widest = extent;
+        split_dim = d;
+      }
+    }
+
+    const int left_parts = n_parts / 2;
+    IndexType* mid = begin + (end - begin) * left_parts / n_parts;
+    std::nth_element(begin, mid, end, [&](IndexType a, IndexType b) {
+      return points[static_cast<size_t>(a) * dim_ + split_dim]
+             < points[static_cast<size_t>(b) * dim_ + split_dim];
+    });
+
+    if (nthread > 1) {
+      std::thread left(&PyKDTForest::spatial_partition,
+                       this,
+                       points,
+                       begin,
+                       mid,
+                       first_part,
+                       left_parts,
+                       nthread / 2,
+                       std::ref(parts));
+      spatial_partition(points,
+                        mid,
+                        end,
+                        first_part + left_parts,
+                        n_parts - left_parts,
+                        nthread - nthread / 2,
+                        parts);
+      left.join();
+    } else {
+      spatial_partition(points, begin, mid, first_part, left_parts, 1, parts);
+      spatial_partition(points,
+                        mid,
+                        end,
+                        first_part + left_parts,
+                        n_parts - left_parts,
+                        1,
+                        parts);
+    }
+  }
+
+  /* shards owning spatially partitioned copies of data. call without gil -
+   * it is only acquired to allocate shard buffers. */
+  std::vector<ShardPtr> spatial_shards(const DataT* d_ptr,
+                                       const IndexType len,
+                                       const int n_shards,
+                                       const int nthread) const {
+    const int n_threads = resolve_nthread(nthread);
+
+    IndexVector ids(len);
+    for (IndexType i{}; i < len; ++i) {
+      ids[i] = i;
+    }
+    std::vector<std::pair<IndexType*, IndexType*>> parts(n_shards);
+    spatial_partition(d_ptr,
+                      ids.data(),
+                      ids.data() + len,
+                      0,
+                      n_shards,
+                      n_threads,
+                      parts);
+
+    parts.erase(std::remove_if(parts.begin(),
+                               parts.end(),
+                               [](const std::pair<IndexType*, IndexType*>& p) {
+                                 return p.first == p.second;
+                               }),
+                parts.end());
+    size_t max_part{};
+    for (const auto& part : parts) {
+      max_part =
+          std::max(max_part, static_cast<size_t>(part.second - part.first));
+    }
+
+    // allocate
+    std::vector<ShardPtr> shards;
+    {
+      py::gil_scoped_acquire acquire;
+      check_index_limit(static_cast<size_t>(datalen_) + len, max_part);
+      for (const auto& part : parts) {
+        ShardPtr shard(new Shard);
+        shard->datalen_ = static_cast<IndexType>(part.second - part.first);
+        shard->data_ = py::array_t<DataT>(
+            {static_cast<py::ssize_t>(shard->datalen_),
+             static_cast<py::ssize_t>(dim_)});
+        shard->data_ptr_ = static_cast<DataT*>(shard->data_.request().ptr);
+        shards.emplace_back(std::move(shard));
+      }
+    }
+
+    // copy - sorted ids keep original memory order within a shard
+    auto copy = [&](int begin, int end, int) {
+      for (int s{begin}; s < end; ++s) {
+        Shard& shard = *shards[s];
+        shard.ids_.assign(parts[s].first, parts[s].second);
+        std::sort(shard.ids_.begin(), shard.ids_.end());
+        DataT* s_ptr = const_cast<DataT*>(shard.data_ptr_);
+        for (IndexType i{}; i < shard.datalen_; ++i) {
+          const DataT* point =
+              d_ptr + static_cast<size_t>(shard.ids_[i]) * dim_;
+          std::copy(point, point + dim_, s_ptr + static_cast<size_t>(i) * dim_);
+          shard.ids_[i] += datalen_;
+        }
+      }
+    };
+    nthread_execution(copy, static_cast<int>(shards.size()), n_threads);
+
+    return shards;
+  }
+};
+
+template<typename T, unsigned int metric>
+void add_kdt_forest_pyclass(py::module_& m, const char* class_name) {
+  using KDTForest = PyKDTForest<T, metric>;
+
+  py::class_<KDTForest> klasse(m, class_name);
+
+  klasse.def(py::init<>())
+      .def(py::init<py::array_t<T>, int, bool, size_t, int>(),
+           py::arg("tree_data"),
+           py::arg("n_shards") = 0,
+           py::arg("spatial") = false,
+           py::arg("leaf_size") = 10,
+           py::arg("nthread") = 1)
+      .def_readonly("dim", &KDTForest::dim_)
+      .def_readonly("metric", &KDTForest::metric_)
+      .def_readonly("size", &KDTForest::datalen_)
+      .def_property_readonly("n_shards", &KDTForest::n_shards)
+      .def_property_readonly("shard_sizes", &KDTForest::shard_sizes)
+      .def("newforest",
+           &KDTForest::newforest,
+           py::arg("tree_data"),
+           py::arg("n_shards") = 0,
+           py::arg("spatial") = false,
+           py::arg("leaf_size") = 10,
+           py::arg("nthread") = 1)
+      .def("append",
+           &KDTForest::append,
+           py::arg("data"),
+           py::arg("n_shards") = 1,
+           py::arg("spatial") = false,
+           py::arg("copy") = true,
+           py::arg("nthread") = 1)
+      .def("compact",
+           &KDTForest::compact,
+           py::arg("min_shard_size"),
+           py::arg("nthread") = 1)
+      .def("knn_search",
+           &KDTForest::knn_search,
+           py::arg("queries"),
+           py::arg("kneighbors"),
+           py::arg("nthread"),
+           py::return_value_policy::move)
+      .def("query",
+           &KDTForest::query,
+           py::arg("queries"),
+           py::arg("nthread"),
+           py::return_value_policy::move);
+
+  add_single_query_defs(klasse);
+
+  klasse
+      .def("radius_search",
+           &KDTForest::radius_search,
+           py::arg("queries"),
+           py::arg("radius"),
+           py::arg("return_sorted"),
+           py::arg("nthread"),
+           py::return_value_policy::move)
+      .def("rknn_search",
+           &KDTForest::rknn_search,
+           py::arg("queries"),
+           py::arg("radius"),
+           py::arg("n_nearest"),
+           py::arg("nthread"),
+           py::return_value_policy::move)
+      .def("query_ball_point",
+           &KDTForest::query_ball_point,
+           py::arg("queries"),
+           py::arg("radius"),
+           py::arg("return_sorted"),
+           py::arg("nthread"),
+           py::return_value_policy::move)
+      .def("radii_search",
+           &KDTForest::radii_search,
+           py::arg("queries"),
+           py::arg("radii"),
+           py::arg("return_sorted"),
+           py::arg("nthread"),
+           py::return_value_policy::move);
+}
+
+} // namespace napf
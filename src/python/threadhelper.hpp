@@ -2,13 +2,23 @@
 
 #include <algorithm>
 #include <thread>
+#include <vector>
 
 namespace napf {
 
+/// returns number of usable threads.
+/// negative input looks for hardware_concurrency
+inline int resolve_nthread(const int nthread) {
+  if (nthread < 0) {
+    return std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+  }
+  return std::max(nthread, 1);
+}
+
 template<typename Func, typename IndexT>
 void nthread_execution(Func& f, const IndexT total, const IndexT nthread) {
   // if nthread == 1, don't even bother creating thread
-  if (nthread == 1 || nthread == 0) {
+  if (nthread == 1 || nthread == 0 || total < 2) {
     f(0, total, 0);
     return;
   }
@@ -28,15 +38,14 @@ void nthread_execution(Func& f, const IndexT total, const IndexT nthread) {
   std::vector<std::thread> tpool;
   tpool.reserve(n_usable_threads);
 
-  for (int i{0}; i < (n_usable_threads - 1); i++) {
-    tpool.emplace_back(std::thread{f, i * chunk_size, (i + 1) * chunk_size, i});
-  }
-  {
-    // last one
-    tpool.emplace_back(std::thread{f,
-                                   (n_usable_threads - 1) * chunk_size,
-                                   total,
-                                   n_usable_threads - 1});
+  for (int i{0}; i < n_usable_threads; i++) {
+    const IndexT begin = i * chunk_size;
+    // chunk_size is rounded up, so last threads may have nothing left
+    if (begin >= total) {
+      break;
+    }
+    const IndexT end = std::min(begin + chunk_size, total);
+    tpool.emplace_back(std::thread{f, begin, end, i});
   }
 
   for (auto& t : tpool) {
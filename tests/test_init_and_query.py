@@ -107,6 +107,180 @@ class InitAndQueryTest(unittest.TestCase):
 
         loop_all_and_test(dims, data_type, metrics, test_func)
 
+    def test_forest(self):
+        dims = [1, 2, 3, 7]
+        data_type = ["float64", "float32", "int64", "int32"]
+        metrics = [1, 2]
+
+        def test_func(dim, data_t, metric):
+            n_data = 300
+            tree_data = (np.random.random((n_data, dim)) * n_data).astype(
+                data_t
+            )
+            queries = (np.random.random((50, dim)) * n_data).astype(data_t)
+            kdt = napf.KDT(tree_data, metric)
+
+            for spatial in [False, True]:
+                # build with first part and append the rest
+                # shard and thread counts that don't divide evenly
+                kdf = napf.KDTForest(
+                    tree_data[:200],
+                    metric,
+                    nthread=4,
+                    n_shards=5,
+                    spatial=spatial,
+                )
+                # more small shards than threads for compaction.
+                # appends copy, so ingest buffer can be reused
+                buffer = np.empty((8, dim), dtype=data_t)
+                for begin in range(200, 256, 8):
+                    buffer[:] = tree_data[begin : begin + 8]
+                    kdf.append(buffer)
+                kdf.append(tree_data[256:], n_shards=2, spatial=spatial)
+                assert kdf.size == n_data
+                assert kdf.shard_sizes.sum() == n_data
+
+                def compare():
+                    # distances should match single tree
+                    k_dist, k_ids = kdt.knn_search(queries, 3)
+                    f_dist, f_ids = kdf.knn_search(queries, 3)
+                    assert np.allclose(k_dist, f_dist)
+                    # ids may differ for ties, but distances can't
+                    assert np.allclose(
+                        kdf.knn_search(tree_data[f_ids[:, 0]], 1)[0], 0
+                    )
+
+                    r = n_data / 5
+                    k_ids, k_dist = kdt.radius_search(queries, r, True)
+                    f_ids, f_dist = kdf.radius_search(queries, r, True)
+                    for k_d, f_d in zip(k_dist, f_dist):
+                        assert np.allclose(k_d, f_d)
+
+                    k_ids = kdt.query_ball_point(queries, r, True)
+                    f_ids = kdf.query_ball_point(queries, r, True)
+                    for k_i, f_i in zip(k_ids, f_ids):
+                        assert list(k_i) == list(f_i)
+
+                compare()
+                n_shards = kdf.n_shards
+                assert kdf.compact(60, nthread=4) < n_shards
+                assert kdf.shard_sizes.sum() == n_data
+                compare()
+
+                future = kdf.compact(n_data + 1, background=True)
+                assert future.result() == kdf.n_shards == 1
+                # errors are re-raised, e.g. negative size isn't unsigned
+                with self.assertRaises(TypeError):
+                    kdf.compact(-1, background=True).result()
+                compare()
+
+        loop_all_and_test(dims, data_type, metrics, test_func)
+
+    def test_single_query(self):
+        dims = [1, 2, 3, 5]
+        data_type = ["float64", "float32", "int64", "int32"]
+        metrics = [1, 2]
+
+        def test_func(dim, data_t, metric):
+            n_data = 100
+            tree_data = (np.random.random((n_data, dim)) * n_data).astype(
+                data_t
+            )
+            queries = (np.random.random((10, dim)) * n_data).astype(data_t)
+
+            for kdt in [
+                napf.KDT(tree_data, metric),
+                napf.KDTForest(tree_data, metric, n_shards=3, spatial=True),
+            ]:
+                dist, ids = kdt.knn_search(queries, 3)
+
+                for i, q in enumerate(queries):
+                    # array input
+                    d, _ = kdt.query_point(q)
+                    assert np.isclose(d, dist[i, 0])
+                    # scalar input
+                    if dim <= 3:
+                        d, _ = kdt.query_point(*q.tolist())
+                        assert np.isclose(d, dist[i, 0])
+
+                # reusable outputs
+                out_dist, out_ids = kdt.knn_buffers(len(queries), 3)
+                kdt.knn_search_into(queries, 3, out_dist, out_ids)
+                assert np.allclose(out_dist, dist)
+                kdt.knn_search_into(queries[0], 3, out_dist, out_ids)
+                assert np.allclose(out_dist[0], dist[0])
+
+                # entries beyond tree size get dummies, not stale values
+                tiny = type(kdt)(tree_data[:2], metric)
+                tiny.knn_search_into(queries[0], 4, out_dist, out_ids)
+                assert (out_dist.ravel()[2:4] < 0).all()
+                assert (out_ids.ravel()[2:4] == np.iinfo(np.uint32).max).all()
+
+                r = n_data / 4
+                r_ids, r_dist = kdt.radius_search(queries, r, True)
+                out_ids, out_dist = kdt.radius_buffers()
+                for i, q in enumerate(queries):
+                    n = kdt.radius_search_into(q, r, True, out_ids, out_dist)
+                    assert n == len(r_ids[i])
+                    assert np.allclose(list(out_dist), list(r_dist[i]))
+
+        loop_all_and_test(dims, data_type, metrics, test_func)
+
+    def test_auto_tune(self):
+        napf.tuning.clear_cache()
+        tree_data = np.random.random((2000, 3))
+        queries = np.random.random((100, 3))
+        # keep calibration short
+        options = {
+            "sample_size": 500,
+            "build_sample_size": 1000,
+            "leaf_sizes": (8, 16),
+            "max_nthread": 2,
+            "repeat": 1,
+        }
+
+        kdt = napf.KDT(tree_data, auto_tune=options)
+        tuning = kdt.tuning
+        assert tuning["leaf_size"] in (8, 16)
+        assert tuning["build_nthread"] in (1, 2)
+        assert tuning["nthread"] in (1, 2)
+        assert kdt.nthread == tuning["nthread"]
+        assert set(tuning["thresholds"]) == {
+            "knn_search",
+            "query",
+            "radius_search",
+            "rknn_search",
+            "query_ball_point",
+            "radii_search",
+        }
+        assert napf.KDT(tree_data).tuning is None
+
+        # similar shape reuses cached result, but returns a copy
+        cached = napf.KDT(tree_data[:1900], auto_tune=options).tuning
+        assert cached == tuning and cached is not tuning
+        cached["thresholds"]["query"] = -1
+        assert napf.tuning.tune(tree_data, **options) == tuning
+
+        # different calibration options are cached separately
+        other = napf.tuning.tune(tree_data, kneighbors=2, **options)
+        assert other["key"] != tuning["key"]
+
+        # kneighbors is clamped to tiny trees
+        tiny = napf.tuning.tune(tree_data[:5], **options)
+        assert tiny["leaf_size"] in (8, 16)
+
+        # tuning doesn't change results
+        ref_dist, _ = napf.KDT(tree_data).knn_search(queries, 3)
+        dist, _ = kdt.knn_search(queries, 3)
+        assert np.allclose(dist, ref_dist)
+        dist, _ = kdt.knn_search(queries[:1], 3)
+        assert np.allclose(dist, ref_dist[:1])
+
+        kdf = napf.KDTForest(tree_data, auto_tune=options)
+        assert kdf.tuning == tuning
+        dist, _ = kdf.knn_search(queries, 3)
+        assert np.allclose(dist, ref_dist)
+
 
 if __name__ == "__main__":
     unittest.main()